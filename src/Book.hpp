@@ -2,9 +2,13 @@
 #pragma once
 
 #include "Message.hpp"
+#include "Orders.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <stdexcept>
+#include <vector>
 
 namespace fix2book {
 
@@ -21,153 +25,475 @@ struct Bool2Sort<false, Key> {
   using Sort = std::greater<Key>;
 };
 
+using PriceKey = int64_t;
+
+inline PriceKey CreatePriceKey(const double price) {
+  return static_cast<PriceKey>(price * 100000000);
+}
+
+// Orders of market-by-order books. Books with sides without orders queues
+// inherit the empty one, so it takes no space.
+template <bool hasOrders>
+class OrdersStorage {};
+template <>
+class OrdersStorage<true> {
+ protected:
+  Orders m_orders;
+};
+
 }  // namespace Details
 
-class Book {
-  template <bool isAscendingSort>
-  class Side {
-   public:
-    struct Level {
-      double price;
-      double value;
-    };
-    using Key = int64_t;
-    using Levels =
-        std::map<Key,
-                 Level,
-                 typename Details::Bool2Sort<isAscendingSort, Key>::Sort>;
-    using Iterator = typename Levels::const_iterator;
-
-    Side() = default;
-    Side(Side&&) = default;
-    Side(const Side&) = delete;
-    Side& operator=(Side&&) = default;
-    Side& operator=(const Side&) = delete;
-    ~Side() = default;
-
-    size_t GetSize() const { return m_levels.size(); }
-
-    Iterator GetLevelAt(const size_t index) const {
-      auto result = m_levels.cbegin();
-      for (size_t i = 0; i < index; ++i) {
-        ++result;
+// Decoded market data entry, so books can be updated without message text.
+struct MdUpdate {
+  // MDEntryID, used only by market-by-order books. Points into the message
+  // or the update log, which are kept while the update is applied.
+  Orders::Id id;
+  double price;
+  double value;
+  // Message::MdEntry::MDUpdateAction.
+  uint8_t action;
+  // Message::MdEntry::MDEntryType.
+  uint8_t type;
+};
+
+// Books read ranges of any entry type by this function, so other entries, as
+// market-by-price update log entries, are expanded only when they are split
+// by sides.
+inline const MdUpdate& ToMdUpdate(const MdUpdate& update) { return update; }
+
+// Mode, decoding and buffers which are common for all book types.
+class BookBase {
+ public:
+  enum Mode {
+    // Levels are set by the feed directly.
+    Mode_MarketByPrice,
+    // Levels are aggregated from orders keyed by MDEntryID (278).
+    Mode_MarketByOrder,
+  };
+
+  using Updates = std::vector<MdUpdate>;
+
+  // Decodes bid and offer entries of the message, entries of snapshot are
+  // decoded as new.
+  static void Decode(const Message& message, const Mode mode, Updates& result) {
+    result.clear();
+    const auto isSnapshot = message.GetType() == 'W';
+    for (auto entry = message.ReadFirstMDEntry(); entry;
+         entry = entry->ReadNextMDEntry()) {
+      // it better to read vals in this order as parser is streamed, and this
+      // order will help with optimization
+      MdUpdate update = {};
+      update.action = isSnapshot ? Message::MdEntry::MDUpdateAction_New
+                                 : entry->ReadMDUpdateAction();
+      update.type = entry->ReadMDEntryType();
+      const auto isBook = update.type == Message::MdEntry::MDEntryType_Bid ||
+                          update.type == Message::MdEntry::MDEntryType_Offer;
+      if (mode == Mode_MarketByOrder) {
+        if (!isBook) {
+          continue;
+        }
+        update.id = entry->ReadMDEntryID();
+        if (update.action == Message::MdEntry::MDUpdateAction_Delete) {
+          // Order keeps its side and price, so delete doesn't need them.
+          result.emplace_back(update);
+          continue;
+        }
+      }
+      update.price = entry->ReadMDEntryPx();
+      update.value = entry->ReadMDEntrySize();
+      if (isBook) {
+        result.emplace_back(update);
+      }
+    }
+  }
+
+ protected:
+  struct Buffers {
+    Updates updates;
+    Updates asks;
+    Updates bids;
+  };
+
+  // Buffers are shared by all books to not allocate it for each message.
+  static Buffers& GetBuffers() {
+    static thread_local Buffers result;
+    return result;
+  }
+
+  template <typename Entry>
+  static void Split(const Entry* begin,
+                    const Entry* const end,
+                    Buffers& buffers) {
+    buffers.asks.clear();
+    buffers.bids.clear();
+    for (; begin != end; ++begin) {
+      const auto& update = ToMdUpdate(*begin);
+      switch (update.type) {
+        case Message::MdEntry::MDEntryType_Bid:
+          buffers.bids.emplace_back(update);
+          break;
+        case Message::MdEntry::MDEntryType_Offer:
+          buffers.asks.emplace_back(update);
+          break;
+        default:
+          break;
       }
-      return result;
     }
+  }
+};
+
+// Side which keeps all levels of the book.
+template <bool isAscendingSort>
+class BookSide {
+ public:
+  struct Level {
+    double price;
+    double value;
+    // FIFO queue of orders, used only by market-by-order books.
+    Orders::Index firstOrder = Orders::nullIndex;
+    Orders::Index lastOrder = Orders::nullIndex;
+  };
+  using Key = Details::PriceKey;
+  using Levels =
+      std::map<Key,
+               Level,
+               typename Details::Bool2Sort<isAscendingSort, Key>::Sort>;
+  using Iterator = typename Levels::const_iterator;
+
+  // Keeps orders queues, so can be used by market-by-order books.
+  static constexpr bool hasOrders = true;
+
+  BookSide() = default;
+  BookSide(BookSide&&) = default;
+  BookSide(const BookSide&) = delete;
+  BookSide& operator=(BookSide&&) = default;
+  BookSide& operator=(const BookSide&) = delete;
+  ~BookSide() = default;
+
+  size_t GetSize() const { return m_levels.size(); }
+  // Number of levels which can be iterated from the best one.
+  size_t GetDepth() const { return m_levels.size(); }
+
+  Iterator GetLevelAt(const size_t index) const {
+    auto result = m_levels.cbegin();
+    for (size_t i = 0; i < index; ++i) {
+      ++result;
+    }
+    return result;
+  }
 
-    void Add(const double price, const double value) {
-      if (!m_levels.emplace(CreateKey(price), Level{price, value}).second) {
+  // Builds levels from snapshot changes, which usually come already sorted,
+  // so each level is appended to the end in constant time.
+  void Build(BookBase::Updates& changes) {
+    Sort(changes);
+    for (const auto& change : changes) {
+      const auto& key = CreateKey(change.price);
+      if (!m_levels.empty() && key == std::prev(m_levels.cend())->first) {
         // Adding without removing.
         throw ProtocolError();
       }
+      m_levels.emplace_hint(m_levels.cend(), key,
+                            Level{change.price, change.value});
     }
+  }
 
-    void Set(const Message::MdEntry::MDUpdateAction& action,
-             const double price,
-             const double val) {
-      if (action == Message::MdEntry::MDUpdateAction_New) {
-        Add(price, val);
-        return;
-      }
-      const auto it = m_levels.find(CreateKey(price));
-      if (it == m_levels.cend()) {
+  // Applies all changes of one message in one pass from the best level to
+  // the worst, instead of searching each price from the root. Changes of the
+  // same price keep message order, so validation is the same as for applying
+  // changes one by one.
+  void Apply(BookBase::Updates& changes) {
+    Sort(changes);
+    auto it = m_levels.begin();
+    for (const auto& change : changes) {
+      const auto& key = CreateKey(change.price);
+      it = Seek(it, key);
+      const auto isFound = it != m_levels.end() && it->first == key;
+      if (change.action == Message::MdEntry::MDUpdateAction_New) {
+        if (isFound) {
+          // Adding without removing.
+          throw ProtocolError();
+        }
+        it = m_levels.emplace_hint(it, key, Level{change.price, change.value});
+      } else if (!isFound) {
         // Modifying without adding.
         throw ProtocolError();
-      }
-      if (action == Message::MdEntry::MDUpdateAction_Delete) {
-        m_levels.erase(it);
+      } else if (change.action == Message::MdEntry::MDUpdateAction_Delete) {
+        it = m_levels.erase(it);
       } else {
-        it->second.value = val;
+        it->second.value = change.value;
       }
     }
+  }
 
-   private:
-    static Key CreateKey(const double price) {
-      return static_cast<Key>(price * 100000000);
+  void AddOrder(Orders& orders, const Orders::Index index) {
+    auto& order = orders.Get(index);
+    auto& level =
+        m_levels.emplace(CreateKey(order.price), Level{order.price, .0})
+            .first->second;
+    level.value += order.value;
+    order.prev = level.lastOrder;
+    order.next = Orders::nullIndex;
+    if (level.lastOrder != Orders::nullIndex) {
+      orders.Get(level.lastOrder).next = index;
+    } else {
+      level.firstOrder = index;
     }
+    level.lastOrder = index;
+  }
 
-    Levels m_levels;
-  };
+  void RemoveOrder(Orders& orders, const Orders::Index index) {
+    const auto& order = orders.Get(index);
+    const auto it = m_levels.find(CreateKey(order.price));
+    if (it == m_levels.cend()) {
+      throw ProtocolError();
+    }
+    auto& level = it->second;
+    if (order.prev != Orders::nullIndex) {
+      orders.Get(order.prev).next = order.next;
+    } else {
+      level.firstOrder = order.next;
+    }
+    if (order.next != Orders::nullIndex) {
+      orders.Get(order.next).prev = order.prev;
+    } else {
+      level.lastOrder = order.prev;
+    }
+    if (level.firstOrder == Orders::nullIndex) {
+      m_levels.erase(it);
+    } else {
+      level.value -= order.value;
+    }
+  }
 
- public:
-  explicit Book(const Message& snapshot) {
-    for (auto entry = snapshot.ReadFirstMDEntry(); entry;
-         entry = entry->ReadNextMDEntry()) {
-      // it better to read vals in this order as parser is streamed, and this
-      // order will help with optimization
-      const auto& type = entry->ReadMDEntryType();
-      const auto& price = entry->ReadMDEntryPx();
-      const auto& val = entry->ReadMDEntrySize();
-      switch (type) {
-        case Message::MdEntry::MDEntryType_Bid:
-          m_bids.Add(price, val);
-          break;
-        case Message::MdEntry::MDEntryType_Offer:
-          m_asks.Add(price, val);
-          break;
-        default:
-          break;
+  void ChangeOrder(Orders& orders,
+                   const Orders::Index index,
+                   const double price,
+                   const double value) {
+    auto& order = orders.Get(index);
+    if (CreateKey(price) != CreateKey(order.price) || value > order.value) {
+      // Moving to another level or increasing loses queue priority.
+      RemoveOrder(orders, index);
+      order.price = price;
+      order.value = value;
+      AddOrder(orders, index);
+      return;
+    }
+    const auto it = m_levels.find(CreateKey(price));
+    if (it == m_levels.cend()) {
+      throw ProtocolError();
+    }
+    it->second.value += value - order.value;
+    order.value = value;
+  }
+
+ private:
+  static Key CreateKey(const double price) {
+    return Details::CreatePriceKey(price);
+  }
+
+  static void Sort(BookBase::Updates& changes) {
+    const auto& compare = [](const MdUpdate& lhs, const MdUpdate& rhs) {
+      return typename Levels::key_compare()(CreateKey(lhs.price),
+                                            CreateKey(rhs.price));
+    };
+    if (!std::is_sorted(changes.cbegin(), changes.cend(), compare)) {
+      std::stable_sort(changes.begin(), changes.end(), compare);
+    }
+  }
+
+  // Finds the first level not better than the key. Levels of the next change
+  // are usually near the previous, so it tries a few steps before search.
+  typename Levels::iterator Seek(typename Levels::iterator it,
+                                 const Key& key) {
+    const auto& compare = m_levels.key_comp();
+    for (size_t i = 0; i < 4 && it != m_levels.end(); ++i, ++it) {
+      if (!compare(it->first, key)) {
+        return it;
       }
     }
+    return m_levels.lower_bound(key);
+  }
+
+  Levels m_levels;
+};
+
+// Book with price levels sides, side type defines how levels are stored.
+template <template <bool> class Side>
+class BasicBook : public BookBase,
+                  private Details::OrdersStorage<Side<true>::hasOrders> {
+ public:
+  explicit BasicBook(const Message& snapshot,
+                     const Mode mode = Mode_MarketByPrice)
+      : m_mode(mode) {
+    CheckMode();
+    auto& buffers = GetBuffers();
+    Decode(snapshot, m_mode, buffers.updates);
+    Build(buffers.updates.data(),
+          buffers.updates.data() + buffers.updates.size());
+  }
+  template <typename Entry>
+  explicit BasicBook(const Entry* begin,
+                     const Entry* end,
+                     const Mode mode = Mode_MarketByPrice)
+      : m_mode(mode) {
+    CheckMode();
+    Build(begin, end);
   }
-  Book(Book&&) = default;
-  Book(const Book&) = delete;
-  Book& operator=(Book&&) = default;
-  Book& operator=(const Book&) = delete;
-  ~Book() = default;
+  BasicBook(BasicBook&&) = default;
+  BasicBook(const BasicBook&) = delete;
+  BasicBook& operator=(BasicBook&&) = default;
+  BasicBook& operator=(const BasicBook&) = delete;
+  ~BasicBook() = default;
 
   void Update(const Message& message) {
-    for (auto entry = message.ReadFirstMDEntry(); entry;
-         entry = entry->ReadNextMDEntry()) {
-      // it better to read vals in this order as parser is streamed, and this
-      // order will help with optimization
-      const auto& action = entry->ReadMDUpdateAction();
-      const auto& type = entry->ReadMDEntryType();
-      const auto& price = entry->ReadMDEntryPx();
-      const auto& val = entry->ReadMDEntrySize();
-      switch (type) {
-        case Message::MdEntry::MDEntryType_Bid:
-          m_bids.Set(action, price, val);
-          break;
-        case Message::MdEntry::MDEntryType_Offer:
-          m_asks.Set(action, price, val);
-          break;
-        default:
-          break;
+    auto& buffers = GetBuffers();
+    Decode(message, m_mode, buffers.updates);
+    Update(buffers.updates.data(),
+           buffers.updates.data() + buffers.updates.size());
+  }
+
+  template <typename Entry>
+  void Update(const Entry* begin, const Entry* const end) {
+    if constexpr (Side<true>::hasOrders) {
+      if (m_mode == Mode_MarketByOrder) {
+        for (; begin != end; ++begin) {
+          UpdateOrder(ToMdUpdate(*begin));
+        }
+        return;
       }
     }
+    auto& buffers = GetBuffers();
+    Split(begin, end, buffers);
+    m_asks.Apply(buffers.asks);
+    m_bids.Apply(buffers.bids);
   }
 
+  // Levels which exist but are not known by the side, as a bounded side after
+  // losing its stored levels, are printed as unknown.
   template <typename OutStream>
   void Print(const size_t size, OutStream& os) const {
     os << "Total SELL: " << m_asks.GetSize() << std::endl;
     {
       const auto levelSize = std::min(size, m_asks.GetSize());
-      if (levelSize > 0) {
-        auto level = m_asks.GetLevelAt(levelSize - 1);
-        for (size_t i = 1; i <= levelSize; ++i, --level) {
-          os << '[' << (levelSize - i) << "] price: " << level->second.price
+      const auto knownSize = std::min(levelSize, m_asks.GetDepth());
+      for (auto i = levelSize; i > knownSize; --i) {
+        os << '[' << (i - 1) << "] price: unknown" << std::endl;
+      }
+      if (knownSize > 0) {
+        auto level = m_asks.GetLevelAt(knownSize - 1);
+        for (size_t i = 1; i <= knownSize; ++i, --level) {
+          os << '[' << (knownSize - i) << "] price: " << level->second.price
              << " (" << level->second.value << ")" << std::endl;
         }
       }
     }
     os << "==========" << std::endl;
     {
-      const auto levelSize = std::min(size, m_asks.GetSize());
-      if (levelSize > 0) {
+      const auto levelSize = std::min(size, m_bids.GetSize());
+      const auto knownSize = std::min(levelSize, m_bids.GetDepth());
+      if (knownSize > 0) {
         auto level = m_bids.GetLevelAt(0);
-        for (size_t i = 0; i < levelSize; ++i, ++level) {
+        for (size_t i = 0; i < knownSize; ++i, ++level) {
           os << '[' << i << "] price: " << level->second.price << " ("
              << level->second.value << ")" << std::endl;
         }
       }
+      for (auto i = knownSize; i < levelSize; ++i) {
+        os << '[' << i << "] price: unknown" << std::endl;
+      }
     }
     os << "Total BUY: " << m_bids.GetSize() << std::endl;
   }
 
  private:
+  // Not a feed error, callers have to choose side type by the mode.
+  void CheckMode() const {
+    if (m_mode == Mode_MarketByOrder && !Side<true>::hasOrders) {
+      throw std::invalid_argument(
+          "market-by-order mode needs sides with orders");
+    }
+  }
+
+  template <typename Entry>
+  void Build(const Entry* begin, const Entry* const end) {
+    if constexpr (Side<true>::hasOrders) {
+      if (m_mode == Mode_MarketByOrder) {
+        for (; begin != end; ++begin) {
+          const auto& update = ToMdUpdate(*begin);
+          AddOrder(update.id,
+                   update.type == Message::MdEntry::MDEntryType_Bid,
+                   update.price, update.value);
+        }
+        return;
+      }
+    }
+    auto& buffers = GetBuffers();
+    Split(begin, end, buffers);
+    m_asks.Build(buffers.asks);
+    m_bids.Build(buffers.bids);
+  }
+
+  void AddOrder(const Orders::Id id,
+                const bool isBid,
+                const double price,
+                const double val) {
+    const auto& index = this->m_orders.Add(id, isBid, price, val);
+    if (isBid) {
+      m_bids.AddOrder(this->m_orders, index);
+    } else {
+      m_asks.AddOrder(this->m_orders, index);
+    }
+  }
+
+  void RemoveOrder(const Orders::Index index) {
+    if (this->m_orders.Get(index).isBid) {
+      m_bids.RemoveOrder(this->m_orders, index);
+    } else {
+      m_asks.RemoveOrder(this->m_orders, index);
+    }
+  }
+
+  void UpdateOrder(const MdUpdate& update) {
+    const auto isBid = update.type == Message::MdEntry::MDEntryType_Bid;
+    if (update.action == Message::MdEntry::MDUpdateAction_New) {
+      AddOrder(update.id, isBid, update.price, update.value);
+      return;
+    }
+
+    const auto& index = this->m_orders.Find(update.id);
+    if (index == Orders::nullIndex) {
+      // Modifying without adding.
+      throw ProtocolError();
+    }
+    if (update.action == Message::MdEntry::MDUpdateAction_Delete) {
+      RemoveOrder(index);
+      this->m_orders.Remove(index);
+      return;
+    }
+
+    auto& order = this->m_orders.Get(index);
+    if (order.isBid != isBid) {
+      RemoveOrder(index);
+      order.isBid = isBid;
+      order.price = update.price;
+      order.value = update.value;
+      if (isBid) {
+        m_bids.AddOrder(this->m_orders, index);
+      } else {
+        m_asks.AddOrder(this->m_orders, index);
+      }
+    } else if (isBid) {
+      m_bids.ChangeOrder(this->m_orders, index, update.price, update.value);
+    } else {
+      m_asks.ChangeOrder(this->m_orders, index, update.price, update.value);
+    }
+  }
+
+  Mode m_mode;
   Side<true> m_asks;
   Side<false> m_bids;
 };
 
+using Book = BasicBook<BookSide>;
+
 }  // namespace fix2book
\ No newline at end of file
@@ -10,14 +10,16 @@
 
 namespace fix2book {
 
-class BookSet {
+template <typename Book>
+class BasicBookSet {
  public:
-  BookSet() = default;
-  BookSet(BookSet &&) = default;
-  BookSet(const BookSet &) = delete;
-  BookSet &operator=(BookSet &&) = default;
-  BookSet &operator=(const BookSet &) = delete;
-  ~BookSet() = default;
+  BasicBookSet() = default;
+  explicit BasicBookSet(const BookBase::Mode mode) : m_mode(mode) {}
+  BasicBookSet(BasicBookSet &&) = default;
+  BasicBookSet(const BasicBookSet &) = delete;
+  BasicBookSet &operator=(BasicBookSet &&) = default;
+  BasicBookSet &operator=(const BasicBookSet &) = delete;
+  ~BasicBookSet() = default;
 
   size_t GetRevision() const { return m_seqNum; }
 
@@ -33,35 +35,64 @@ class BookSet {
   }
 
   void Update(const Message &message) {
-    switch (message.GetType()) {
-      case 'W':  // snapshot
-      case 'X':  // incremental update
-        break;
-      default:
-        return;
+    if (!IsBookMessage(message.GetType())) {
+      return;
     }
     const auto &seqNum = message.ReadMsgSecNum();
     if (m_seqNum >= seqNum) {
       return;
     }
+    Apply(seqNum, message.ReadSymbol(), message.GetType(), message);
+  }
+
+  // Applies already decoded entries, as stored in update logs.
+  template <typename Entry>
+  void Update(const size_t seqNum,
+              const std::string &symbol,
+              const char type,
+              const Entry *begin,
+              const Entry *end) {
+    if (!IsBookMessage(type) || m_seqNum >= seqNum) {
+      return;
+    }
+    Apply(seqNum, symbol, type, begin, end);
+  }
+
+ private:
+  static bool IsBookMessage(const char type) {
+    switch (type) {
+      case 'W':  // snapshot
+      case 'X':  // incremental update
+        return true;
+      default:
+        return false;
+    }
+  }
 
-    auto &book = m_books[message.ReadSymbol()];
-    if (message.GetType() == 'W') {
-      book.second = std::make_shared<Book>(message);
+  template <typename... Source>
+  void Apply(const size_t seqNum,
+             const std::string &symbol,
+             const char type,
+             const Source &... source) {
+    auto &book = m_books[symbol];
+    if (type == 'W') {
+      book.second = std::make_shared<Book>(source..., m_mode);
     } else if (!book.second) {
       // no snapshot for book
       throw ProtocolError();
     } else {
-      book.second->Update(message);
+      book.second->Update(source...);
     }
 
     m_seqNum = book.first = seqNum;
   }
 
- private:
+  BookBase::Mode m_mode = BookBase::Mode_MarketByPrice;
   size_t m_seqNum = 0;
   std::unordered_map<std::string, std::pair<size_t, std::shared_ptr<Book>>>
       m_books;
 };
 
+using BookSet = BasicBookSet<Book>;
+
 }  // namespace fix2book
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "Book.hpp"
+
+#include <array>
+#include <utility>
+
+namespace fix2book {
+
+// Sides which keep only the best levels, plus a few levels of overflow, in a
+// fixed inline array. Book size is constant and each update is a short linear
+// scan. Levels beyond the array are only counted: deletes of stored levels
+// take levels from the overflow, and if it's empty while the feed has more
+// levels, the side has less levels than the depth, and books print the missing
+// ones as unknown, until the next snapshot or until the side has no levels
+// beyond the stored ones.
+template <size_t depth, size_t overflow = 3>
+struct BoundedBookSide {
+  template <bool isAscendingSort>
+  class Side {
+   public:
+    struct Level {
+      double price;
+      double value;
+    };
+    using Key = Details::PriceKey;
+    using Iterator = const std::pair<Key, Level>*;
+
+    static constexpr bool hasOrders = false;
+
+    Side() = default;
+    Side(Side&&) = default;
+    Side(const Side&) = delete;
+    Side& operator=(Side&&) = default;
+    Side& operator=(const Side&) = delete;
+    ~Side() = default;
+
+    size_t GetSize() const { return m_size; }
+    // Number of levels which can be iterated from the best one.
+    size_t GetDepth() const { return m_numberOfLevels; }
+
+    Iterator GetLevelAt(const size_t index) const {
+      return m_levels.data() + index;
+    }
+
+    void Build(BookBase::Updates& changes) {
+      for (const auto& change : changes) {
+        Add(change);
+      }
+    }
+
+    void Apply(BookBase::Updates& changes) {
+      for (const auto& change : changes) {
+        switch (change.action) {
+          case Message::MdEntry::MDUpdateAction_New:
+            Add(change);
+            break;
+          case Message::MdEntry::MDUpdateAction_Delete:
+            Delete(change);
+            break;
+          default:
+            Change(change);
+            break;
+        }
+      }
+    }
+
+   private:
+    using Compare = typename Details::Bool2Sort<isAscendingSort, Key>::Sort;
+
+    // Levels which are better than the boundary are stored all.
+    bool IsStored(const Key& key) const {
+      return !m_hasBoundary || Compare()(key, m_boundary);
+    }
+
+    bool HasLevelsBeyond() const { return m_size > m_numberOfLevels; }
+
+    // Finds the first level not better than the key.
+    size_t Find(const Key& key) const {
+      size_t result = 0;
+      while (result < m_numberOfLevels &&
+             Compare()(m_levels[result].first, key)) {
+        ++result;
+      }
+      return result;
+    }
+
+    void Add(const MdUpdate& change) {
+      const auto& key = Details::CreatePriceKey(change.price);
+      if (!IsStored(key)) {
+        ++m_size;
+        return;
+      }
+      auto index = Find(key);
+      if (index < m_numberOfLevels && m_levels[index].first == key) {
+        // Adding without removing.
+        throw ProtocolError();
+      }
+      ++m_size;
+      if (m_numberOfLevels == m_levels.size()) {
+        m_hasBoundary = true;
+        if (index == m_numberOfLevels) {
+          m_boundary = key;
+          return;
+        }
+        // The worst level goes beyond.
+        --m_numberOfLevels;
+        m_boundary = m_levels[m_numberOfLevels].first;
+      }
+      for (auto i = m_numberOfLevels; i > index; --i) {
+        m_levels[i] = m_levels[i - 1];
+      }
+      m_levels[index] = {key, Level{change.price, change.value}};
+      ++m_numberOfLevels;
+    }
+
+    void Delete(const MdUpdate& change) {
+      const auto& key = Details::CreatePriceKey(change.price);
+      if (!IsStored(key)) {
+        if (!HasLevelsBeyond()) {
+          // Modifying without adding.
+          throw ProtocolError();
+        }
+        --m_size;
+      } else {
+        const auto& index = GetIndex(key);
+        for (auto i = index + 1; i < m_numberOfLevels; ++i) {
+          m_levels[i - 1] = m_levels[i];
+        }
+        --m_numberOfLevels;
+        --m_size;
+      }
+      if (!HasLevelsBeyond()) {
+        // All levels are stored again.
+        m_hasBoundary = false;
+      }
+    }
+
+    void Change(const MdUpdate& change) {
+      const auto& key = Details::CreatePriceKey(change.price);
+      if (!IsStored(key)) {
+        if (!HasLevelsBeyond()) {
+          // Modifying without adding.
+          throw ProtocolError();
+        }
+        return;
+      }
+      m_levels[GetIndex(key)].second.value = change.value;
+    }
+
+    size_t GetIndex(const Key& key) const {
+      const auto& result = Find(key);
+      if (result == m_numberOfLevels || m_levels[result].first != key) {
+        // Modifying without adding.
+        throw ProtocolError();
+      }
+      return result;
+    }
+
+    std::array<std::pair<Key, Level>, depth + overflow> m_levels;
+    size_t m_numberOfLevels = 0;
+    // Number of levels in the book, including levels beyond the stored ones.
+    size_t m_size = 0;
+    bool m_hasBoundary = false;
+    Key m_boundary = 0;
+  };
+};
+
+// Book which keeps only the best levels of each side, without heap for levels.
+template <size_t depth, size_t overflow = 3>
+using BoundedBook =
+    BasicBook<BoundedBookSide<depth, overflow>::template Side>;
+
+}  // namespace fix2book
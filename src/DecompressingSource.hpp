@@ -0,0 +1,556 @@
+#pragma once
+
+#include "Exception.hpp"
+#include "InputSource.hpp"
+
+#ifdef FIX2BOOK_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FIX2BOOK_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fix2book {
+
+// Decompresses input in a background thread into a ring of blocks, so the
+// reader parses one block while the next one is decompressed. Multi-frame zstd
+// input is decoded by several frames in parallel.
+class DecompressingSource : public InputSource {
+ public:
+  enum Format {
+    Format_Gzip,
+    Format_Zstd,
+  };
+
+  // Detects format by magic number, doesn't change stream position.
+  static bool DetectFormat(std::istream &stream, Format &result) {
+    unsigned char magic[4] = {};
+    const auto &position = stream.tellg();
+    stream.read(reinterpret_cast<char *>(magic), sizeof(magic));
+    const auto &size = stream.gcount();
+    stream.clear();
+    stream.seekg(position);
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+      result = Format_Gzip;
+      return true;
+    }
+    if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+        magic[2] == 0x2f && magic[3] == 0xfd) {
+      result = Format_Zstd;
+      return true;
+    }
+    return false;
+  }
+
+  static bool IsSupported(const Format format) {
+    switch (format) {
+#ifdef FIX2BOOK_WITH_ZLIB
+      case Format_Gzip:
+        return true;
+#endif
+#ifdef FIX2BOOK_WITH_ZSTD
+      case Format_Zstd:
+        return true;
+#endif
+      default:
+        return false;
+    }
+  }
+
+  explicit DecompressingSource(
+      std::istream &stream,
+      const Format format,
+      const size_t numberOfThreads = std::thread::hardware_concurrency(),
+      const size_t numberOfBlocks = 2,
+      const size_t blockSize = 1 << 20)
+      : m_stream(stream),
+        m_numberOfThreads(std::max<size_t>(numberOfThreads, 1)),
+        m_blockSize(blockSize),
+        m_ring(std::max<size_t>(numberOfBlocks, 1)) {
+    if (!IsSupported(format)) {
+      throw InputError();
+    }
+    m_thread = std::thread([this, format]() {
+      try {
+        switch (format) {
+#ifdef FIX2BOOK_WITH_ZLIB
+          case Format_Gzip:
+            RunGzip();
+            break;
+#endif
+#ifdef FIX2BOOK_WITH_ZSTD
+          case Format_Zstd:
+            RunZstd();
+            break;
+#endif
+          default:
+            break;
+        }
+      } catch (...) {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = std::current_exception();
+      }
+      {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_isFinished = true;
+      }
+      m_condition.notify_all();
+    });
+  }
+  ~DecompressingSource() override {
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      m_isStopped = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+  }
+
+  bool Read(Block &block) override {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_size > 0 || m_isFinished; });
+    if (m_size == 0) {
+      if (m_error) {
+        std::rethrow_exception(m_error);
+      }
+      return false;
+    }
+    block.swap(m_ring[m_begin]);
+    m_begin = (m_begin + 1) % m_ring.size();
+    --m_size;
+    lock.unlock();
+    m_condition.notify_all();
+    return true;
+  }
+
+ private:
+  // Swaps filled block into the ring, gets back a consumed block for reuse.
+  // Returns false if the source is destroyed and decompression has to stop.
+  bool Write(Block &block) {
+    if (block.empty()) {
+      return true;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(
+        lock, [this]() { return m_size < m_ring.size() || m_isStopped; });
+    if (m_isStopped) {
+      return false;
+    }
+    block.swap(m_ring[(m_begin + m_size) % m_ring.size()]);
+    ++m_size;
+    lock.unlock();
+    m_condition.notify_all();
+    block.clear();
+    return true;
+  }
+
+  // Reads next part of compressed input to the end of the buffer.
+  bool ReadInput(Block &buffer, const size_t size) {
+    const auto &prevSize = buffer.size();
+    buffer.resize(prevSize + size);
+    m_stream.read(buffer.data() + prevSize, size);
+    buffer.resize(prevSize + static_cast<size_t>(m_stream.gcount()));
+    if (m_stream.bad()) {
+      throw InputError();
+    }
+    return buffer.size() > prevSize;
+  }
+
+#ifdef FIX2BOOK_WITH_ZLIB
+  void RunGzip() {
+    z_stream stream = {};
+    // 16 - gzip header, not zlib.
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+      throw InputError();
+    }
+    struct Guard {
+      z_stream &stream;
+      ~Guard() { inflateEnd(&stream); }
+    } guard{stream};
+
+    Block input;
+    Block output;
+    auto isMemberEnd = false;
+    // Full output means inflate may have more output without new input.
+    auto isOutputFull = false;
+    for (;;) {
+      if (stream.avail_in == 0 && !isOutputFull) {
+        input.clear();
+        if (!ReadInput(input, m_blockSize)) {
+          break;
+        }
+        stream.next_in = reinterpret_cast<Bytef *>(input.data());
+        stream.avail_in = static_cast<uInt>(input.size());
+      }
+      if (isMemberEnd) {
+        // Concatenated gzip members, as produced by parallel compressors.
+        if (inflateReset(&stream) != Z_OK) {
+          throw InputError();
+        }
+        isMemberEnd = false;
+      }
+
+      const auto &prevSize = output.size();
+      output.resize(m_blockSize);
+      stream.next_out = reinterpret_cast<Bytef *>(output.data() + prevSize);
+      stream.avail_out = static_cast<uInt>(output.size() - prevSize);
+      const auto &result = inflate(&stream, Z_NO_FLUSH);
+      isOutputFull = stream.avail_out == 0;
+      output.resize(output.size() - stream.avail_out);
+      switch (result) {
+        case Z_STREAM_END:
+          isMemberEnd = true;
+          isOutputFull = false;
+          break;
+        case Z_OK:
+        case Z_BUF_ERROR:
+          break;
+        default:
+          throw InputError();
+      }
+
+      if (output.size() == m_blockSize && !Write(output)) {
+        return;
+      }
+    }
+    if (!isMemberEnd) {
+      // Truncated input.
+      throw InputError();
+    }
+    Write(output);
+  }
+#endif
+
+#ifdef FIX2BOOK_WITH_ZSTD
+  struct DStream {
+    ZSTD_DStream *const handle = ZSTD_createDStream();
+    ~DStream() { ZSTD_freeDStream(handle); }
+  };
+
+  // Pool of threads which decode frames in parallel. Each frame is streamed
+  // into its own short queue of blocks and frames are taken in the order of
+  // adding, so memory depends only on the number of frames and the block size,
+  // not on the frame content size.
+  class FrameDecoders {
+   public:
+    explicit FrameDecoders(const size_t numberOfThreads,
+                           const size_t blockSize)
+        : m_blockSize(blockSize) {
+      for (size_t i = 0; i < numberOfThreads; ++i) {
+        m_threads.emplace_back([this]() { Run(); });
+      }
+    }
+    FrameDecoders(FrameDecoders &&) = delete;
+    FrameDecoders(const FrameDecoders &) = delete;
+    FrameDecoders &operator=(FrameDecoders &&) = delete;
+    FrameDecoders &operator=(const FrameDecoders &) = delete;
+    ~FrameDecoders() {
+      {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopped = true;
+      }
+      m_condition.notify_all();
+      for (auto &thread : m_threads) {
+        thread.join();
+      }
+    }
+
+    // Number of frames which are not taken yet.
+    size_t GetSize() const { return m_frames.size(); }
+
+    void Add(Block input) {
+      auto frame = std::make_unique<Frame>();
+      frame->input = std::move(input);
+      {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.emplace_back(frame.get());
+      }
+      m_frames.emplace_back(std::move(frame));
+      m_condition.notify_all();
+    }
+
+    // Swaps the next block of the oldest frame into the block, the previous
+    // block is reused for decoding. Returns false and removes the frame if
+    // all its blocks are taken.
+    bool Take(Block &block) {
+      auto &frame = *m_frames.front();
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [&frame]() {
+        return !frame.output.empty() || frame.isFinished;
+      });
+      if (frame.output.empty()) {
+        lock.unlock();
+        const auto error = frame.error;
+        m_frames.pop_front();
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        return false;
+      }
+      block.clear();
+      m_free.emplace_back(std::move(block));
+      block = std::move(frame.output.front());
+      frame.output.pop_front();
+      lock.unlock();
+      m_condition.notify_all();
+      return true;
+    }
+
+   private:
+    // Decoded blocks waiting in the queue of a frame.
+    static constexpr size_t maxQueueSize = 2;
+
+    struct Frame {
+      Block input;
+      std::deque<Block> output;
+      bool isFinished = false;
+      std::exception_ptr error;
+    };
+
+    void Run() {
+      DStream stream;
+      Block block;
+      for (;;) {
+        Frame *frame;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_condition.wait(
+              lock, [this]() { return !m_pending.empty() || m_isStopped; });
+          if (m_isStopped) {
+            return;
+          }
+          frame = m_pending.front();
+          m_pending.pop_front();
+        }
+        std::exception_ptr error;
+        try {
+          Decode(stream, *frame, block);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        {
+          const std::lock_guard<std::mutex> lock(m_mutex);
+          frame->error = error;
+          frame->isFinished = true;
+        }
+        m_condition.notify_all();
+      }
+    }
+
+    // Decoder and block are kept by the thread for next frames.
+    void Decode(DStream &stream, Frame &frame, Block &block) {
+      if (ZSTD_isError(ZSTD_initDStream(stream.handle))) {
+        throw InputError();
+      }
+      ZSTD_inBuffer input = {frame.input.data(), frame.input.size(), 0};
+      block.clear();
+      for (;;) {
+        const auto &prevSize = block.size();
+        block.resize(m_blockSize);
+        ZSTD_outBuffer output = {block.data() + prevSize,
+                                 block.size() - prevSize, 0};
+        const auto &status =
+            ZSTD_decompressStream(stream.handle, &output, &input);
+        if (ZSTD_isError(status)) {
+          throw InputError();
+        }
+        block.resize(prevSize + output.pos);
+        if (status == 0) {
+          Push(frame, block);
+          return;
+        }
+        if (block.size() == m_blockSize) {
+          if (!Push(frame, block)) {
+            return;
+          }
+        } else if (input.pos == input.size) {
+          // Truncated frame.
+          throw InputError();
+        }
+      }
+    }
+
+    // Moves the block to the frame queue and gets a free one instead.
+    // Returns false if decoding has to stop.
+    bool Push(Frame &frame, Block &block) {
+      if (block.empty()) {
+        return true;
+      }
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this, &frame]() {
+          return frame.output.size() < maxQueueSize || m_isStopped;
+        });
+        if (m_isStopped) {
+          return false;
+        }
+        frame.output.emplace_back(std::move(block));
+        if (m_free.empty()) {
+          block = Block();
+        } else {
+          block = std::move(m_free.back());
+          m_free.pop_back();
+        }
+      }
+      m_condition.notify_all();
+      return true;
+    }
+
+    const size_t m_blockSize;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    // Frames in the order of adding, only the reading thread changes it.
+    std::deque<std::unique_ptr<Frame>> m_frames;
+    // Frames waiting for a thread.
+    std::deque<Frame *> m_pending;
+    std::vector<Block> m_free;
+    bool m_isStopped = false;
+
+    std::vector<std::thread> m_threads;
+  };
+
+  void RunZstd() {
+    // Frames bigger than this are decoded by streaming right from the input,
+    // without reading whole frame to memory.
+    const auto maxFrameSize = m_blockSize * 16;
+    // One frame more than threads, so threads have work while the oldest
+    // frame is taken.
+    const auto maxNumberOfFrames = m_numberOfThreads + 1;
+
+    FrameDecoders decoders(m_numberOfThreads, m_blockSize);
+    Block input;
+    size_t inputBegin = 0;
+    auto isInputEnd = false;
+    Block output;
+
+    // Writes frames in order until no more than the size are left.
+    const auto &take = [this, &decoders, &output](const size_t size) {
+      while (decoders.GetSize() > size) {
+        if (decoders.Take(output) && !Write(output)) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    for (;;) {
+      // Next frame is added as soon as the oldest one is taken.
+      if (!take(maxNumberOfFrames - 1)) {
+        return;
+      }
+      if (inputBegin == input.size()) {
+        input.clear();
+        inputBegin = 0;
+      }
+      // Finds where the next frame ends, reading more input if needed.
+      size_t frameSize = 0;
+      for (;;) {
+        frameSize = ZSTD_findFrameCompressedSize(input.data() + inputBegin,
+                                                 input.size() - inputBegin);
+        if (!ZSTD_isError(frameSize) || isInputEnd ||
+            input.size() - inputBegin >= maxFrameSize) {
+          break;
+        }
+        if (inputBegin > 0) {
+          input.erase(input.begin(), input.begin() + inputBegin);
+          inputBegin = 0;
+        }
+        isInputEnd = !ReadInput(input, m_blockSize);
+      }
+      if (input.size() == inputBegin) {
+        break;
+      }
+
+      if (!ZSTD_isError(frameSize)) {
+        if (frameSize < m_blockSize) {
+          decoders.Add(Block(input.cbegin() + inputBegin,
+                             input.cbegin() + inputBegin + frameSize));
+          inputBegin += frameSize;
+          continue;
+        }
+        // Big frame takes the input buffer, only the rest is copied.
+        if (inputBegin > 0) {
+          input.erase(input.begin(), input.begin() + inputBegin);
+          inputBegin = 0;
+        }
+        Block rest(input.cbegin() + frameSize, input.cend());
+        input.resize(frameSize);
+        decoders.Add(std::move(input));
+        input = std::move(rest);
+        continue;
+      }
+      if (isInputEnd) {
+        // Truncated or corrupted input.
+        throw InputError();
+      }
+
+      // The frame is too big to buffer, keeping frames order.
+      if (!take(0) || !DecompressLargeFrame(input, inputBegin, isInputEnd)) {
+        return;
+      }
+    }
+    take(0);
+  }
+
+  bool DecompressLargeFrame(Block &input, size_t &inputBegin, bool &isEnd) {
+    DStream stream;
+    Block output;
+    for (;;) {
+      if (inputBegin == input.size()) {
+        input.clear();
+        inputBegin = 0;
+        if (isEnd || !ReadInput(input, m_blockSize)) {
+          // Truncated frame.
+          throw InputError();
+        }
+      }
+      ZSTD_inBuffer in = {input.data() + inputBegin, input.size() - inputBegin,
+                          0};
+      const auto &prevSize = output.size();
+      output.resize(m_blockSize);
+      ZSTD_outBuffer out = {output.data() + prevSize, output.size() - prevSize,
+                            0};
+      const auto &status = ZSTD_decompressStream(stream.handle, &out, &in);
+      if (ZSTD_isError(status)) {
+        throw InputError();
+      }
+      inputBegin += in.pos;
+      output.resize(prevSize + out.pos);
+      if (output.size() == m_blockSize && !Write(output)) {
+        return false;
+      }
+      if (status == 0) {
+        return Write(output);
+      }
+    }
+  }
+#endif
+
+  std::istream &m_stream;
+  const size_t m_numberOfThreads;
+  const size_t m_blockSize;
+
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::vector<Block> m_ring;
+  size_t m_begin = 0;
+  size_t m_size = 0;
+  bool m_isStopped = false;
+  bool m_isFinished = false;
+  std::exception_ptr m_error;
+
+  std::thread m_thread;
+};
+
+}  // namespace fix2book
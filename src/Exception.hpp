@@ -16,4 +16,18 @@ class ProtocolError : public Exception {
 
 class UnknownProtocolFieldError final : public ProtocolError {};
 
+class InputError : public Exception {
+ public:
+  ~InputError() override = default;
+
+  const char* what() const noexcept override { return "input error"; }
+};
+
+class OutputError : public Exception {
+ public:
+  ~OutputError() override = default;
+
+  const char* what() const noexcept override { return "output error"; }
+};
+
 }  // namespace fix2book
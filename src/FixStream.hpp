@@ -2,43 +2,98 @@
 #pragma once
 
 #include "BookSet.hpp"
+#include "InputSource.hpp"
 #include "Message.hpp"
+#include "UpdateLog.hpp"
 
-#include <istream>
+#include <cstring>
+#include <string>
 
 namespace fix2book {
 
 class FixStream {
  public:
-  explicit FixStream(const unsigned char soh, std::istream &stream)
-      : m_soh(soh), m_stream(stream) {}
+  explicit FixStream(const unsigned char soh, InputSource &source)
+      : m_soh(soh), m_source(source), m_cursor(m_block.data()) {}
   FixStream(FixStream &&) = default;
   FixStream(const FixStream &) = delete;
   FixStream &operator=(FixStream &&) = delete;
   FixStream &operator=(const FixStream &) = delete;
   ~FixStream() = default;
 
-  explicit operator bool() const { return static_cast<bool>(m_stream); }
+  explicit operator bool() const { return !m_isEnd; }
 
-  FixStream &operator>>(BookSet &books) {
-    if (!m_stream) {
+  template <typename Book>
+  FixStream &operator>>(BasicBookSet<Book> &books) {
+    return Read([&books](const Message &message) { books.Update(message); });
+  }
+
+  FixStream &operator>>(UpdateLogWriter &log) {
+    return Read([&log](const Message &message) { log.Write(message); });
+  }
+
+ private:
+  template <typename Callback>
+  FixStream &Read(const Callback &callback) {
+    if (m_isEnd) {
       return *this;
     }
 
-    std::string messageContent;
-    if (!std::getline(m_stream, messageContent)) {
+    const char *begin;
+    const char *end;
+    if (!ReadLine(begin, end)) {
       return *this;
     }
 
-    books.Update(
-        Message(m_soh, messageContent.cbegin(), messageContent.cend()));
+    callback(Message(m_soh, begin, end));
 
     return *this;
   }
 
- private:
+  // Frames the next line right in the input block. Only a line which is split
+  // between blocks is copied.
+  bool ReadLine(const char *&begin, const char *&end) {
+    m_line.clear();
+    for (;;) {
+      const auto *const blockEnd = m_block.data() + m_block.size();
+      const auto *const lineEnd =
+          m_cursor == blockEnd
+              ? nullptr
+              : static_cast<const char *>(
+                    std::memchr(m_cursor, '\n', blockEnd - m_cursor));
+      if (lineEnd) {
+        if (m_line.empty()) {
+          begin = m_cursor;
+          end = lineEnd;
+        } else {
+          m_line.append(m_cursor, lineEnd);
+          begin = m_line.data();
+          end = begin + m_line.size();
+        }
+        m_cursor = lineEnd + 1;
+        return true;
+      }
+
+      m_line.append(m_cursor, blockEnd);
+      if (!m_source.Read(m_block)) {
+        m_isEnd = true;
+        if (m_line.empty()) {
+          return false;
+        }
+        begin = m_line.data();
+        end = begin + m_line.size();
+        return true;
+      }
+      m_cursor = m_block.data();
+    }
+  }
+
   const unsigned char m_soh;
-  std::istream &m_stream;
+  InputSource &m_source;
+  InputSource::Block m_block;
+  const char *m_cursor;
+  std::string m_line;
+  bool m_isEnd = false;
 };
 
-}  // namespace fix2book
\ No newline at end of file
+}  // namespace fix2book
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <istream>
+#include <vector>
+
+namespace fix2book {
+
+// Source of input data read by blocks. Blocks are exchanged by swapping, so a
+// consumed block returns to the source and its memory is reused.
+class InputSource {
+ public:
+  using Block = std::vector<char>;
+
+  InputSource() = default;
+  InputSource(InputSource &&) = delete;
+  InputSource(const InputSource &) = delete;
+  InputSource &operator=(InputSource &&) = delete;
+  InputSource &operator=(const InputSource &) = delete;
+  virtual ~InputSource() = default;
+
+  // Replaces the consumed block by the next one, returns false at the end of
+  // input. Returned block is never empty.
+  virtual bool Read(Block &block) = 0;
+};
+
+class StreamSource : public InputSource {
+ public:
+  explicit StreamSource(std::istream &stream, const size_t blockSize = 1 << 20)
+      : m_stream(stream), m_blockSize(blockSize) {}
+  ~StreamSource() override = default;
+
+  bool Read(Block &block) override {
+    block.resize(m_blockSize);
+    m_stream.read(block.data(), block.size());
+    block.resize(static_cast<size_t>(m_stream.gcount()));
+    return !block.empty();
+  }
+
+ private:
+  std::istream &m_stream;
+  const size_t m_blockSize;
+};
+
+}  // namespace fix2book
@@ -1,37 +1,122 @@
 
 #include "BookSet.hpp"
+#include "BoundedBookSide.hpp"
+#include "DecompressingSource.hpp"
 #include "FixStream.hpp"
+#include "InputSource.hpp"
+#include "MappedFile.hpp"
+#include "UpdateLog.hpp"
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
 
 using namespace fix2book;
 
 namespace {
 
+constexpr size_t defaultNumberOfLevels = 5;
+
 bool ReadArgs(int argc,
               char *argv[],
               const char *&file,
               char &soh,
-              size_t &numberOfLevels) {
+              size_t &numberOfLevels,
+              Book::Mode &mode,
+              const char *&convertFile,
+              bool &isBounded) {
   if (argc >= 2 && argv[1][0]) {
     file = &argv[1][0];
     soh = '^';
-    numberOfLevels = 5;
+    numberOfLevels = defaultNumberOfLevels;
+    for (int i = 2; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (arg == "--mbo") {
+        mode = Book::Mode_MarketByOrder;
+      } else if (arg == "--convert" && i + 1 < argc) {
+        convertFile = argv[++i];
+      } else if (arg == "--bounded") {
+        isBounded = true;
+      }
+    }
     return true;
   }
   if (argc == 0) {
     std::cerr << "Wrong arguments." << std::endl;
   } else {
     std::cout << "Usage:" << std::endl
-              << "\t" << argv[0] << R"( "fileName">" [ --debug ], where:)"
+              << "\t" << argv[0]
+              << R"( "fileName">" [ --mbo ] [ --convert "logFile" ])"
+                 R"( [ --bounded ] [ --debug ], where:)"
+              << std::endl
               << std::endl
+              << "\t\t <fileName>: path to input file, gzip and zstd files "
+                 "are decompressed on the fly, required;"
+              << std::endl
+              << "\t\t --mbo: market-by-order feed, orders are keyed by "
+                 "MDEntryID (278);"
+              << std::endl
+              << "\t\t --convert <logFile>: writes decoded updates to binary "
+                 "update log instead of printing, the log can be used as "
+                 "<fileName> for faster replays;"
+              << std::endl
+              << "\t\t --bounded: books keep only the printed levels and a "
+                 "few more, levels which are lost after deletes are printed "
+                 "as unknown until the next snapshot, market-by-price only;"
               << std::endl
-              << "\t\t <fileName>: path to input file, required;" << std::endl
               << std::endl;
   }
   return false;
 }
+
+std::unique_ptr<InputSource> OpenSource(std::istream &stream) {
+  DecompressingSource::Format format;
+  if (!DecompressingSource::DetectFormat(stream, format)) {
+    return std::make_unique<StreamSource>(stream);
+  }
+  if (!DecompressingSource::IsSupported(format)) {
+    std::cerr << "Compressed source file format is not supported by this "
+                 "build."
+              << std::endl;
+    return {};
+  }
+  return std::make_unique<DecompressingSource>(stream, format);
+}
+
+template <typename BookSet, typename Stream>
+void Replay(Stream &stream,
+            const Book::Mode mode,
+            const size_t numberOfLevels) {
+  BookSet books(mode);
+  while (stream) {
+    const auto rev = books.GetRevision();
+    stream >> books;
+    if (rev >= books.GetRevision()) {
+      continue;
+    }
+    books.Print(books.GetRevision(), numberOfLevels, std::cout);
+  }
+}
+
+template <typename Stream>
+bool Replay(Stream &stream,
+            const Book::Mode mode,
+            const size_t numberOfLevels,
+            const bool isBounded) {
+  if (!isBounded) {
+    Replay<BookSet>(stream, mode, numberOfLevels);
+    return true;
+  }
+  if (mode != Book::Mode_MarketByPrice) {
+    std::cerr << "Bounded books support only market-by-price feeds."
+              << std::endl;
+    return false;
+  }
+  Replay<BasicBookSet<BoundedBook<defaultNumberOfLevels>>>(stream, mode,
+                                                           numberOfLevels);
+  return true;
+}
 }  // namespace
 
 int main(int argc, char *argv[]) {
@@ -39,26 +124,52 @@ int main(int argc, char *argv[]) {
     const char *sourceFilePath;
     char soh = 0x01;
     auto numberOfLevels = std::numeric_limits<size_t>::max();
-    if (!ReadArgs(argc, argv, sourceFilePath, soh, numberOfLevels)) {
+    auto mode = Book::Mode_MarketByPrice;
+    const char *convertFilePath = nullptr;
+    auto isBounded = false;
+    if (!ReadArgs(argc, argv, sourceFilePath, soh, numberOfLevels, mode,
+                  convertFilePath, isBounded)) {
       return 1;
     }
 
-    std::fstream source(sourceFilePath);
+    std::ifstream source(sourceFilePath, std::ios::binary);
     if (!source) {
       std::cerr << "Filed to open source file \"" << sourceFilePath << "\"."
                 << std::endl;
       return 1;
     }
-    FixStream fix(soh, source);
-
-    BookSet books;
-    while (fix) {
-      const auto rev = books.GetRevision();
-      fix >> books;
-      if (rev >= books.GetRevision()) {
-        continue;
+
+    if (UpdateLogStream::Detect(source)) {
+      source.close();
+      const MappedFile file(sourceFilePath);
+      UpdateLogStream log(file);
+      return Replay(log, log.GetMode(), numberOfLevels, isBounded) ? 0 : 1;
+    }
+
+    const auto input = OpenSource(source);
+    if (!input) {
+      return 1;
+    }
+    FixStream fix(soh, *input);
+
+    if (convertFilePath) {
+      std::ofstream convertFile(convertFilePath,
+                                std::ios::binary | std::ios::trunc);
+      if (!convertFile) {
+        std::cerr << "Filed to open log file \"" << convertFilePath << "\"."
+                  << std::endl;
+        return 1;
       }
-      books.Print(books.GetRevision(), numberOfLevels, std::cout);
+      UpdateLogWriter log(convertFile, mode);
+      while (fix) {
+        fix >> log;
+      }
+      log.Finish();
+      return 0;
+    }
+
+    if (!Replay(fix, mode, numberOfLevels, isBounded)) {
+      return 1;
     }
 
   } catch (const std::exception &ex) {
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Exception.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+
+namespace fix2book {
+
+// Read-only memory mapping of the whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const char *path) {
+#ifdef _WIN32
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+      throw InputError();
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+      CloseHandle(m_file);
+      throw InputError();
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) {
+      return;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0,
+                                   nullptr);
+    if (!m_mapping) {
+      CloseHandle(m_file);
+      throw InputError();
+    }
+    m_data = static_cast<const char *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+      CloseHandle(m_mapping);
+      CloseHandle(m_file);
+      throw InputError();
+    }
+#else
+    m_file = open(path, O_RDONLY);
+    if (m_file < 0) {
+      throw InputError();
+    }
+    struct stat info;
+    if (fstat(m_file, &info) != 0) {
+      close(m_file);
+      throw InputError();
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size == 0) {
+      return;
+    }
+    auto *const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED) {
+      close(m_file);
+      throw InputError();
+    }
+    // Replay reads the file from the beginning to the end.
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(data);
+#endif
+  }
+  MappedFile(MappedFile &&) = delete;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(MappedFile &&) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+#ifdef _WIN32
+    if (m_data) {
+      UnmapViewOfFile(m_data);
+      CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+#else
+    if (m_data) {
+      munmap(const_cast<char *>(m_data), m_size);
+    }
+    close(m_file);
+#endif
+  }
+
+  const char *GetData() const { return m_data; }
+  size_t GetSize() const { return m_size; }
+
+ private:
+#ifdef _WIN32
+  HANDLE m_file;
+  HANDLE m_mapping = nullptr;
+#else
+  int m_file;
+#endif
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+}  // namespace fix2book
@@ -5,19 +5,22 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace fix2book {
 
 class Content {
  public:
-  using Iterator = std::string::const_iterator;
+  // Points into the input buffer, so messages are parsed without copying.
+  using Iterator = const char *;
 
   explicit Content(const unsigned char soh, Iterator begin, Iterator end)
       : m_soh(soh),
-        m_begin(std::move(begin)),
-        m_end(std::move(end)),
+        m_begin(begin),
+        m_end(end),
         m_cursor(m_begin) {}
   Content(Content &&) = default;
   Content(const Content &) = delete;
@@ -52,6 +55,13 @@ class Content {
         tag, [this](Iterator &it) { return ReadStringValue(it); });
   }
 
+  // The result points into the message input, so it's valid only while the
+  // input is.
+  std::string_view ReadStringViewField(const std::string &tag) const {
+    return ReadField<std::string_view>(
+        tag, [this](Iterator &it) { return ReadStringViewValue(it); });
+  }
+
   bool FindTagBegin(const std::string &tag, Iterator &cursor) const {
     auto it = cursor;
     auto end = m_end;
@@ -88,7 +98,7 @@ class Content {
   }
 
   void CheckValueCursor(const Iterator &cursor) const {
-    if (*cursor == m_soh || cursor >= m_end) {
+    if (cursor >= m_end || *cursor == m_soh) {
       throw ProtocolError();
     }
   }
@@ -105,6 +115,17 @@ class Content {
     return result;
   }
 
+  std::string_view ReadStringViewValue(Iterator &cursor) const {
+    CheckValueCursor(cursor);
+    const auto end = std::find(cursor, m_end, m_soh);
+    if (end == m_end) {
+      throw ProtocolError();
+    }
+    const std::string_view result(cursor, std::distance(cursor, end));
+    cursor = std::next(end);
+    return result;
+  }
+
   template <typename Result, typename Iterator>
   Result ReadIntValue(Iterator &cursor) const {
     CheckValueCursor(cursor);
@@ -186,7 +207,7 @@ class Message : public Content {
   class MdEntry : public Content {
    public:
     // 269
-    enum MDEntryType {
+    enum MDEntryType : uint8_t {
       MDEntryType_Bid = 0,
       MDEntryType_Offer = 1,
       MDEntryType_Trade = 2,
@@ -194,7 +215,7 @@ class Message : public Content {
       MDEntryType_SettlementPrice = 6,
     };
     // 279
-    enum MDUpdateAction {
+    enum MDUpdateAction : uint8_t {
       MDUpdateAction_New = 0,
       MDUpdateAction_Change = 1,
       MDUpdateAction_Delete = 2,
@@ -238,6 +259,13 @@ class Message : public Content {
       return static_cast<MDEntryType>(result);
     }
 
+    // 278, points into the message input.
+    std::string_view ReadMDEntryID() const {
+      return ReadStringViewField("278=");
+    }
+    // 37
+    std::string ReadOrderID() const { return ReadStringField("37="); }
+
     double ReadMDEntryPx() const { return ReadDoubleField("270="); }
     double ReadMDEntrySize() const { return ReadDoubleField("271="); }
 
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "Exception.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fix2book {
+
+// Storage of resting orders for market-by-order books. Orders are kept in a
+// flat pool and linked by indexes, the pool is indexed by open-addressing hash
+// table of order IDs with linear probing, so millions of orders cost a few
+// flat vectors. IDs are FIX strings, each order keeps its ID to resolve hash
+// collisions, pool slots are reused with their ID buffers, so IDs longer than
+// the small string buffer don't allocate per order either.
+class Orders {
+ public:
+  using Id = std::string_view;
+  using Index = uint32_t;
+
+  static constexpr Index nullIndex = std::numeric_limits<Index>::max();
+
+  struct Order {
+    std::string id;
+    uint64_t hash;
+    double price;
+    double value;
+    // Links in FIFO queue of the price level.
+    Index prev;
+    Index next;
+    bool isBid;
+  };
+
+  Orders() = default;
+  Orders(Orders &&) = default;
+  Orders(const Orders &) = delete;
+  Orders &operator=(Orders &&) = default;
+  Orders &operator=(const Orders &) = delete;
+  ~Orders() = default;
+
+  size_t GetSize() const { return m_size; }
+
+  Order &Get(const Index index) { return m_pool[index]; }
+  const Order &Get(const Index index) const { return m_pool[index]; }
+
+  Index Find(const Id id) const {
+    if (m_buckets.empty()) {
+      return nullIndex;
+    }
+    const auto &hash = Hash(id);
+    for (auto bucket = GetBucket(hash);; bucket = GetNextBucket(bucket)) {
+      const auto index = m_buckets[bucket];
+      if (index == nullIndex || IsEqual(m_pool[index], hash, id)) {
+        return index;
+      }
+    }
+  }
+
+  Index Add(const Id id,
+            const bool isBid,
+            const double price,
+            const double value) {
+    // Keeps load factor not more than 1/2, so probe sequences stay short.
+    if ((m_size + 1) * 2 > m_buckets.size()) {
+      Rehash(m_buckets.empty() ? 16 : m_buckets.size() * 2);
+    }
+    const auto &hash = Hash(id);
+    auto bucket = GetBucket(hash);
+    for (; m_buckets[bucket] != nullIndex; bucket = GetNextBucket(bucket)) {
+      if (IsEqual(m_pool[m_buckets[bucket]], hash, id)) {
+        // Adding without removing.
+        throw ProtocolError();
+      }
+    }
+
+    Index result;
+    if (m_free != nullIndex) {
+      result = m_free;
+      m_free = m_pool[result].next;
+    } else {
+      if (m_pool.size() >= nullIndex) {
+        throw ProtocolError();
+      }
+      result = static_cast<Index>(m_pool.size());
+      m_pool.emplace_back();
+    }
+    auto &order = m_pool[result];
+    order.id.assign(id.data(), id.size());
+    order.hash = hash;
+    order.price = price;
+    order.value = value;
+    order.prev = nullIndex;
+    order.next = nullIndex;
+    order.isBid = isBid;
+    m_buckets[bucket] = result;
+    ++m_size;
+
+    return result;
+  }
+
+  void Remove(const Index index) {
+    auto bucket = GetBucket(m_pool[index].hash);
+    while (m_buckets[bucket] != index) {
+      bucket = GetNextBucket(bucket);
+    }
+    // Backward-shift deletion, keeps probe sequences without tombstones.
+    for (auto next = GetNextBucket(bucket);; next = GetNextBucket(next)) {
+      const auto nextIndex = m_buckets[next];
+      if (nextIndex == nullIndex) {
+        break;
+      }
+      const auto home = GetBucket(m_pool[nextIndex].hash);
+      // Moves the entry only if its home bucket is not in (bucket, next].
+      if (((next - home) & GetMask()) >= ((next - bucket) & GetMask())) {
+        m_buckets[bucket] = nextIndex;
+        bucket = next;
+      }
+    }
+    m_buckets[bucket] = nullIndex;
+
+    m_pool[index].next = m_free;
+    m_free = index;
+    --m_size;
+  }
+
+ private:
+  size_t GetMask() const { return m_buckets.size() - 1; }
+
+  static uint64_t Hash(const Id id) {
+    // FNV-1a, then splitmix64 finalizer, as venues often use sequential IDs
+    // which differ only in the last chars.
+    uint64_t result = 0xcbf29ce484222325ull;
+    for (const auto &ch : id) {
+      result = (result ^ static_cast<unsigned char>(ch)) * 0x100000001b3ull;
+    }
+    result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ull;
+    result = (result ^ (result >> 27)) * 0x94d049bb133111ebull;
+    result ^= result >> 31;
+    return result;
+  }
+
+  static bool IsEqual(const Order &order, const uint64_t hash, const Id id) {
+    return order.hash == hash && order.id == id;
+  }
+
+  size_t GetBucket(const uint64_t hash) const {
+    return static_cast<size_t>(hash) & GetMask();
+  }
+
+  size_t GetNextBucket(const size_t bucket) const {
+    return (bucket + 1) & GetMask();
+  }
+
+  void Rehash(const size_t size) {
+    std::vector<Index> buckets(size, nullIndex);
+    m_buckets.swap(buckets);
+    for (const auto &index : buckets) {
+      if (index == nullIndex) {
+        continue;
+      }
+      auto bucket = GetBucket(m_pool[index].hash);
+      while (m_buckets[bucket] != nullIndex) {
+        bucket = GetNextBucket(bucket);
+      }
+      m_buckets[bucket] = index;
+    }
+  }
+
+  std::vector<Order> m_pool;
+  std::vector<Index> m_buckets;
+  Index m_free = nullIndex;
+  size_t m_size = 0;
+};
+
+}  // namespace fix2book
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "Book.hpp"
+#include "BookSet.hpp"
+#include "Exception.hpp"
+#include "MappedFile.hpp"
+#include "Message.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fix2book {
+
+// Update log is a binary file with already decoded book updates, so repeated
+// replays don't parse FIX text again. All fields have fixed width and native
+// byte order, the file is read by memory mapping:
+//   UpdateLogHeader;
+//   for each message: UpdateLogRecord, UpdateLogEntry[numberOfEntries],
+//     IDs of the entries, padding to 8 bytes;
+//   for each symbol: uint32_t size, chars, padding to 8 bytes.
+// IDs are stored only by market-by-order logs.
+// Symbols dictionary is written at the end, as symbols are known only after
+// conversion, the header has its offset.
+struct UpdateLogHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t version;
+  uint64_t symbolsOffset;
+  uint32_t numberOfSymbols;
+  uint8_t mode;
+  uint8_t reserved[3];
+
+  static constexpr char validMagic[8] = {'F', '2', 'B', 'U', 'L', 'O', 'G', 0};
+  static constexpr uint32_t validByteOrder = 0x01020304;
+  static constexpr uint32_t validVersion = 3;
+};
+static_assert(sizeof(UpdateLogHeader) == 32, "Header layout is changed");
+
+struct UpdateLogRecord {
+  uint64_t seqNum;
+  uint32_t symbol;
+  uint32_t numberOfEntries;
+  char type;
+  uint8_t reserved[7];
+};
+static_assert(sizeof(UpdateLogRecord) == 24, "Record layout is changed");
+
+// MdUpdate without the ID, which is stored after the entries of the message.
+struct UpdateLogEntry {
+  double price;
+  double value;
+  uint32_t idSize;
+  uint8_t action;
+  uint8_t type;
+  uint8_t reserved[2];
+};
+static_assert(sizeof(UpdateLogEntry) == 24, "Entry layout is changed");
+
+// Used for market-by-price logs, which have no IDs.
+inline MdUpdate ToMdUpdate(const UpdateLogEntry &entry) {
+  MdUpdate result = {};
+  result.price = entry.price;
+  result.value = entry.value;
+  result.action = entry.action;
+  result.type = entry.type;
+  return result;
+}
+
+// Converts FIX messages to update log. Messages are filtered and decoded as
+// BookSet does it, so the log replays to the same books.
+class UpdateLogWriter {
+ public:
+  explicit UpdateLogWriter(std::ostream &stream, const Book::Mode mode)
+      : m_stream(stream), m_mode(mode) {
+    // Real header is written by Finish.
+    const UpdateLogHeader header = {};
+    WriteData(header);
+  }
+  UpdateLogWriter(UpdateLogWriter &&) = delete;
+  UpdateLogWriter(const UpdateLogWriter &) = delete;
+  UpdateLogWriter &operator=(UpdateLogWriter &&) = delete;
+  UpdateLogWriter &operator=(const UpdateLogWriter &) = delete;
+  ~UpdateLogWriter() = default;
+
+  void Write(const Message &message) {
+    switch (message.GetType()) {
+      case 'W':  // snapshot
+      case 'X':  // incremental update
+        break;
+      default:
+        return;
+    }
+    const auto &seqNum = message.ReadMsgSecNum();
+    if (m_seqNum >= seqNum) {
+      return;
+    }
+
+    UpdateLogRecord record = {};
+    record.seqNum = seqNum;
+    {
+      const auto &symbol = m_symbols.emplace(
+          message.ReadSymbol(), static_cast<uint32_t>(m_symbols.size()));
+      record.symbol = symbol.first->second;
+    }
+    record.type = message.GetType();
+    Book::Decode(message, m_mode, m_updates);
+    record.numberOfEntries = static_cast<uint32_t>(m_updates.size());
+
+    WriteData(record);
+    size_t idsSize = 0;
+    m_entries.resize(m_updates.size());
+    for (size_t i = 0; i < m_updates.size(); ++i) {
+      const auto &update = m_updates[i];
+      auto &entry = m_entries[i];
+      entry = {};
+      entry.price = update.price;
+      entry.value = update.value;
+      entry.idSize = static_cast<uint32_t>(update.id.size());
+      entry.action = update.action;
+      entry.type = update.type;
+      idsSize += update.id.size();
+    }
+    m_stream.write(reinterpret_cast<const char *>(m_entries.data()),
+                   m_entries.size() * sizeof(UpdateLogEntry));
+    for (const auto &update : m_updates) {
+      m_stream.write(update.id.data(), update.id.size());
+    }
+    static const char padding[8] = {};
+    m_stream.write(padding, (8 - idsSize % 8) % 8);
+    if (!m_stream) {
+      throw OutputError();
+    }
+
+    m_seqNum = seqNum;
+  }
+
+  // Writes symbols dictionary and header, the log is not valid before it.
+  void Finish() {
+    UpdateLogHeader header = {};
+    std::memcpy(header.magic, UpdateLogHeader::validMagic,
+                sizeof(header.magic));
+    header.byteOrder = UpdateLogHeader::validByteOrder;
+    header.version = UpdateLogHeader::validVersion;
+    header.symbolsOffset = static_cast<uint64_t>(m_stream.tellp());
+    header.numberOfSymbols = static_cast<uint32_t>(m_symbols.size());
+    header.mode = static_cast<uint8_t>(m_mode);
+
+    std::vector<const std::string *> symbols(m_symbols.size());
+    for (const auto &symbol : m_symbols) {
+      symbols[symbol.second] = &symbol.first;
+    }
+    for (const auto &symbol : symbols) {
+      const auto &size = static_cast<uint32_t>(symbol->size());
+      WriteData(size);
+      m_stream.write(symbol->data(), symbol->size());
+      static const char padding[8] = {};
+      m_stream.write(padding, (8 - (sizeof(size) + size) % 8) % 8);
+    }
+
+    m_stream.seekp(0);
+    WriteData(header);
+    m_stream.flush();
+    if (!m_stream) {
+      throw OutputError();
+    }
+  }
+
+ private:
+  template <typename Data>
+  void WriteData(const Data &data) {
+    m_stream.write(reinterpret_cast<const char *>(&data), sizeof(data));
+    if (!m_stream) {
+      throw OutputError();
+    }
+  }
+
+  std::ostream &m_stream;
+  const Book::Mode m_mode;
+  size_t m_seqNum = 0;
+  std::unordered_map<std::string, uint32_t> m_symbols;
+  Book::Updates m_updates;
+  std::vector<UpdateLogEntry> m_entries;
+};
+
+// Replays update log, entries are passed to books right from the mapped file.
+class UpdateLogStream {
+ public:
+  // Checks the log magic, doesn't change stream position.
+  static bool Detect(std::istream &stream) {
+    char magic[sizeof(UpdateLogHeader::validMagic)] = {};
+    const auto &position = stream.tellg();
+    stream.read(magic, sizeof(magic));
+    const auto &size = stream.gcount();
+    stream.clear();
+    stream.seekg(position);
+    return size == sizeof(magic) &&
+           std::memcmp(magic, UpdateLogHeader::validMagic, sizeof(magic)) == 0;
+  }
+
+  explicit UpdateLogStream(const MappedFile &file)
+      : m_cursor(file.GetData()), m_end(m_cursor) {
+    UpdateLogHeader header;
+    if (file.GetSize() < sizeof(header)) {
+      throw InputError();
+    }
+    std::memcpy(&header, file.GetData(), sizeof(header));
+    if (std::memcmp(header.magic, UpdateLogHeader::validMagic,
+                    sizeof(header.magic)) != 0 ||
+        header.byteOrder != UpdateLogHeader::validByteOrder ||
+        header.version != UpdateLogHeader::validVersion ||
+        header.symbolsOffset < sizeof(header) ||
+        header.symbolsOffset > file.GetSize()) {
+      throw InputError();
+    }
+    switch (header.mode) {
+      case Book::Mode_MarketByPrice:
+      case Book::Mode_MarketByOrder:
+        m_mode = static_cast<Book::Mode>(header.mode);
+        break;
+      default:
+        throw InputError();
+    }
+
+    m_cursor += sizeof(header);
+    m_end = file.GetData() + header.symbolsOffset;
+
+    const auto *symbol = m_end;
+    const auto *const symbolsEnd = file.GetData() + file.GetSize();
+    m_symbols.reserve(header.numberOfSymbols);
+    for (uint32_t i = 0; i < header.numberOfSymbols; ++i) {
+      uint32_t size;
+      if (static_cast<size_t>(symbolsEnd - symbol) < sizeof(size)) {
+        throw InputError();
+      }
+      std::memcpy(&size, symbol, sizeof(size));
+      symbol += sizeof(size);
+      if (static_cast<size_t>(symbolsEnd - symbol) < size) {
+        throw InputError();
+      }
+      m_symbols.emplace_back(symbol, size);
+      symbol += size;
+      const auto &padding = (8 - (sizeof(size) + size) % 8) % 8;
+      symbol += std::min<size_t>(padding, symbolsEnd - symbol);
+    }
+  }
+  UpdateLogStream(UpdateLogStream &&) = default;
+  UpdateLogStream(const UpdateLogStream &) = delete;
+  UpdateLogStream &operator=(UpdateLogStream &&) = delete;
+  UpdateLogStream &operator=(const UpdateLogStream &) = delete;
+  ~UpdateLogStream() = default;
+
+  Book::Mode GetMode() const { return m_mode; }
+
+  explicit operator bool() const { return m_cursor < m_end; }
+
+  template <typename Book>
+  UpdateLogStream &operator>>(BasicBookSet<Book> &books) {
+    if (m_cursor >= m_end) {
+      return *this;
+    }
+
+    if (static_cast<size_t>(m_end - m_cursor) < sizeof(UpdateLogRecord)) {
+      throw InputError();
+    }
+    const auto &record = *reinterpret_cast<const UpdateLogRecord *>(m_cursor);
+    m_cursor += sizeof(record);
+    if (record.symbol >= m_symbols.size() ||
+        static_cast<size_t>(m_end - m_cursor) / sizeof(UpdateLogEntry) <
+            record.numberOfEntries) {
+      throw InputError();
+    }
+    const auto *const entries =
+        reinterpret_cast<const UpdateLogEntry *>(m_cursor);
+    const auto *const entriesEnd = entries + record.numberOfEntries;
+    m_cursor = reinterpret_cast<const char *>(entriesEnd);
+    size_t idsSize = 0;
+    for (auto it = entries; it != entriesEnd; ++it) {
+      if (!IsValid(*it)) {
+        throw InputError();
+      }
+      idsSize += it->idSize;
+    }
+    const auto *const ids = m_cursor;
+    const auto &paddedIdsSize = idsSize + (8 - idsSize % 8) % 8;
+    if (static_cast<size_t>(m_end - m_cursor) < paddedIdsSize) {
+      throw InputError();
+    }
+    m_cursor += paddedIdsSize;
+
+    const auto &symbol = m_symbols[record.symbol];
+    if (m_mode == Book::Mode_MarketByPrice) {
+      // Entries are expanded by books.
+      books.Update(record.seqNum, symbol, record.type, entries, entriesEnd);
+      return *this;
+    }
+    m_updates.resize(record.numberOfEntries);
+    size_t idBegin = 0;
+    for (size_t i = 0; i < m_updates.size(); ++i) {
+      auto &update = m_updates[i];
+      update = ToMdUpdate(entries[i]);
+      update.id = Orders::Id(ids + idBegin, entries[i].idSize);
+      idBegin += entries[i].idSize;
+    }
+    books.Update(record.seqNum, symbol, record.type, m_updates.data(),
+                 m_updates.data() + m_updates.size());
+
+    return *this;
+  }
+
+ private:
+  // Writer stores only book entries decoded from valid messages.
+  static bool IsValid(const UpdateLogEntry &update) {
+    switch (update.action) {
+      case Message::MdEntry::MDUpdateAction_New:
+      case Message::MdEntry::MDUpdateAction_Change:
+      case Message::MdEntry::MDUpdateAction_Delete:
+        break;
+      default:
+        return false;
+    }
+    switch (update.type) {
+      case Message::MdEntry::MDEntryType_Bid:
+      case Message::MdEntry::MDEntryType_Offer:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  const char *m_cursor;
+  const char *m_end;
+  Book::Mode m_mode;
+  std::vector<std::string> m_symbols;
+  Book::Updates m_updates;
+};
+
+}  // namespace fix2book